@@ -1,3 +1,6 @@
+// infile: text file of masses (regenerated from the toy model below), or a
+// ROOT file from ppcollision.cc holding hMassOS and hMassMixed, in which case
+// the mixed-event background is subtracted before the fit.
 void extract2(const char* infile = "simulated_mass.txt") {
     // --- Settings ---
     const int nBins = 100;
@@ -9,36 +12,100 @@ void extract2(const char* infile = "simulated_mass.txt") {
     hMass->SetMarkerStyle(20);
     hMass->SetMarkerSize(1.0);
 
-    // --- Random data simulation (replace later with real data reading) ---
-    TRandom3 rand(42);
-    std::ofstream fout(infile);
-    const double signalYield = 500;
-    const double bkgYield = 2000;
+    bool fromPairs = TString(infile).EndsWith(".root");
+    TString dataLabel = fromPairs ? "PYTHIA pairs, mixed-event subtracted" : "Simulated Data";
 
-    // Signal: Gaussian centered at 3.1 GeV/c^2 (J/psi mass)
-    for (int i = 0; i < signalYield; i++) {
-        double mass = rand.Gaus(3.097, 0.05); // mean, sigma
-        fout << mass << "\n";
+    if (fromPairs) {
+        // --- Read pair spectra from ppcollision.cc ---
+        TFile *fin = TFile::Open(infile, "READ");
+        if (!fin || fin->IsZombie()) {
+            std::cerr << "Error: cannot open " << infile << std::endl;
+            return;
+        }
+        TH1 *hOS = (TH1*)fin->Get("hMassOS");
+        TH1 *hMixed = (TH1*)fin->Get("hMassMixed");
+        if (!hOS) {
+            std::cerr << "Error: could not find hMassOS in file " << infile << std::endl;
+            return;
+        }
+        if (hOS->GetNbinsX() != nBins || hOS->GetXaxis()->GetXmin() != minMass || hOS->GetXaxis()->GetXmax() != maxMass) {
+            std::cerr << "Error: hMassOS binning does not match " << nBins << " bins in [" << minMass << ", " << maxMass << "]" << std::endl;
+            return;
+        }
+        hMass->Sumw2();
+        hMass->Add(hOS);
+        if (hMixed) hMass->Add(hMixed, -1);
+        else std::cerr << "Warning: no hMassMixed in " << infile << ", fitting without background subtraction" << std::endl;
+        hMass->GetXaxis()->SetTitle("Invariant Mass M_{pair} (GeV/c^{2})");
+        hMass->GetYaxis()->SetTitle(hOS->GetYaxis()->GetTitle());
+        if (!hMixed) dataLabel = "PYTHIA pairs";
+        fin->Close();
+    } else {
+        // --- Random data simulation (replace later with real data reading) ---
+        TRandom3 rand(42);
+        std::ofstream fout(infile);
+        const double signalYield = 500;
+        const double bkgYield = 2000;
+
+        // Signal: Gaussian centered at 3.1 GeV/c^2 (J/psi mass)
+        for (int i = 0; i < signalYield; i++) {
+            double mass = rand.Gaus(3.097, 0.05); // mean, sigma
+            fout << mass << "\n";
+        }
+        // Background: exponential falloff
+        for (int i = 0; i < bkgYield; i++) {
+            double mass = minMass - log(rand.Uniform()) * 0.8; // lambda
+            if (mass < maxMass) fout << mass << "\n";
+        }
+        fout.close();
+
+        // --- Read data ---
+        std::ifstream fin(infile);
+        double val;
+        while (fin >> val) {
+            if (val >= minMass && val <= maxMass) hMass->Fill(val);
+        }
+        fin.close();
     }
-    // Background: exponential falloff
-    for (int i = 0; i < bkgYield; i++) {
-        double mass = minMass - log(rand.Uniform()) * 0.8; // lambda
-        if (mass < maxMass) fout << mass << "\n";
+
+    if (hMass->Integral() <= 0) {
+        std::cerr << "Error: no entries in " << minMass << "-" << maxMass << " GeV/c^2 to fit" << std::endl;
+        return;
     }
-    fout.close();
 
-    // --- Read data ---
-    std::ifstream fin(infile);
-    double val;
-    while (fin >> val) {
-        if (val >= minMass && val <= maxMass) hMass->Fill(val);
+    // --- Initial guesses from the histogram (its scale may be counts or mb) ---
+    // Background: exponential through the mean contents of the outer 10 bins;
+    // signal: excess over that background at the J/psi mass
+    const int nEdge = 10;
+    double yLo = hMass->Integral(1, nEdge) / nEdge;
+    double yHi = hMass->Integral(nBins - nEdge + 1, nBins) / nEdge;
+    double xLo = hMass->GetBinCenter(1 + nEdge / 2);
+    double xHi = hMass->GetBinCenter(nBins - nEdge / 2);
+    double bkgSlope = (yLo > 0 && yHi > 0) ? log(yHi / yLo) / (xHi - xLo) : -1.;
+    double bkgNorm = (yLo > 0 ? yLo : hMass->GetMaximum()) / exp(bkgSlope * xLo);
+    double sigNorm = hMass->GetBinContent(hMass->FindBin(3.097)) - bkgNorm * exp(bkgSlope * 3.097);
+    if (sigNorm <= 0) sigNorm = 0.1 * hMass->GetMaximum();
+
+    // Excess over that background in 3.0-3.2 GeV/c^2; below 3 sigma there is
+    // no resonance to fit (e.g. hadron pairs from HardQCD without charmonium)
+    double excess = 0, excessErr2 = 0;
+    for (int b = hMass->FindBin(3.0); b <= hMass->FindBin(3.2); b++) {
+        excess += hMass->GetBinContent(b) - bkgNorm * exp(bkgSlope * hMass->GetBinCenter(b));
+        excessErr2 += pow(hMass->GetBinError(b), 2);
     }
-    fin.close();
+    bool hasPeak = excess > 3 * sqrt(excessErr2);
 
     // --- Fit function: Gaussian + exponential background ---
     TF1 *fitFunc = new TF1("fitFunc", "[0]*exp([1]*x) + [2]*exp(-0.5*((x-[3])/[4])**2)", minMass, maxMass);
-    fitFunc->SetParameters(100, -1, 200, 3.1, 0.05); // initial guesses
+    fitFunc->SetParameters(bkgNorm, bkgSlope, sigNorm, 3.1, 0.05); // initial guesses
     fitFunc->SetParNames("BkgNorm", "BkgSlope", "SigNorm", "SigMean", "SigSigma");
+    if (!hasPeak) {
+        std::cerr << "Warning: no significant excess at the J/psi mass (" << excess << " +- " << sqrt(excessErr2)
+                  << "), fitting the background only" << std::endl;
+        fitFunc->FixParameter(2, 0.);
+        fitFunc->FixParameter(3, 3.097);
+        fitFunc->FixParameter(4, 0.05);
+    }
 
     // --- Canvas ---
     TCanvas *c1 = new TCanvas("c1", "STAR-style Analysis", 800, 600);
@@ -53,8 +120,8 @@ void extract2(const char* infile = "simulated_mass.txt") {
     TLegend *leg = new TLegend(0.2, 0.55, 0.48, 0.75);
     leg->SetBorderSize(0);
     leg->SetFillStyle(0);
-    leg->AddEntry(hMass, "Simulated Data", "lep");
-    leg->AddEntry(fitFunc, "Fit: Gauss + Exp", "l");
+    leg->AddEntry(hMass, dataLabel, "lep");
+    leg->AddEntry(fitFunc, hasPeak ? "Fit: Gauss + Exp" : "Fit: Exp (no peak)", "l");
     leg->Draw();
 
     // --- Annotation ---
@@ -0,0 +1,300 @@
+#ifndef JETCLUSTERING_H
+#define JETCLUSTERING_H
+
+// Sequential-recombination jet clustering (kT, Cambridge/Aachen, anti-kT).
+//
+// Particles are binned in (rapidity, phi) tiles at least R wide, so a pair
+// closer than R always sits in the same or in adjacent tiles. Each pseudojet
+// keeps its geometric nearest neighbour found among those tiles, and the
+// smallest d_ij / d_iB is taken from a binary heap; after a merge only the
+// tiles around the two parents and the new jet are revisited. This replaces
+// the O(N^3) textbook loop with roughly O(N log N) work for physical events.
+//
+// All buffers are members and are only cleared between events, so once
+// their capacity has grown to the largest event no further allocation
+// takes place.
+//
+// Usage:
+//   JetClustering jets(JetClustering::kAntiKt, 0.4, 3.0, 1.0);
+//   jets.Clear();
+//   jets.AddParticle(px, py, pz, e);     // for each input particle
+//   const std::vector<JetClustering::Jet> &found = jets.Cluster();
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+class JetClustering {
+public:
+    // Exponent p of the kT weight: d_ij = min(kT_i^2p, kT_j^2p) dR_ij^2 / R^2
+    enum Algorithm { kKt = 1, kCambridgeAachen = 0, kAntiKt = -1 };
+
+    struct Jet {
+        double px, py, pz, e;
+        int nConstituents;
+
+        double pT() const { return std::sqrt(px * px + py * py); }
+        double phi() const { return std::atan2(py, px); }
+        double eta() const {
+            double p = std::sqrt(px * px + py * py + pz * pz);
+            if (p == std::fabs(pz)) return pz >= 0 ? 1e10 : -1e10;
+            return 0.5 * std::log((p + pz) / (p - pz));
+        }
+    };
+
+    // Tiles cover |y| < maxRap; particles beyond it fall into the edge tiles,
+    // which is still exact, only slower if there are many of them.
+    JetClustering(Algorithm alg, double R, double ptMin, double maxRap = 5.0)
+        : fAlg(alg), fR2(R * R), fPtMin(ptMin), fMaxRap(maxRap), fStamp(0) {
+        fNRap = std::max(1, (int)(2 * maxRap / R));
+        fNPhi = std::max(1, (int)(2 * M_PI / R));
+        fRapWidth = 2 * maxRap / fNRap;
+        fPhiWidth = 2 * M_PI / fNPhi;
+
+        // Neighbour lists (tile itself included), without duplicates when
+        // the phi ring has fewer than three tiles
+        int nTiles = fNRap * fNPhi;
+        fNeighbourStart.assign(nTiles + 1, 0);
+        for (int iy = 0; iy < fNRap; iy++) {
+            for (int iphi = 0; iphi < fNPhi; iphi++) {
+                int t = iy * fNPhi + iphi;
+                fNeighbourStart[t] = fNeighbours.size();
+                for (int dy = -1; dy <= 1; dy++) {
+                    if (iy + dy < 0 || iy + dy >= fNRap) continue;
+                    for (int dphi = -1; dphi <= 1; dphi++) {
+                        int n = (iy + dy) * fNPhi + (iphi + dphi + fNPhi) % fNPhi;
+                        if (std::find(fNeighbours.begin() + fNeighbourStart[t], fNeighbours.end(), n) == fNeighbours.end())
+                            fNeighbours.push_back(n);
+                    }
+                }
+            }
+        }
+        fNeighbourStart[nTiles] = fNeighbours.size();
+        fTileHead.assign(nTiles, -1);
+        fTileStamp.assign(nTiles, 0);
+    }
+
+    void Clear() {
+        fP.clear();
+        fJets.clear();
+    }
+
+    void AddParticle(double px, double py, double pz, double e) {
+        PseudoJet p;
+        p.px = px;
+        p.py = py;
+        p.pz = pz;
+        p.e = e;
+        p.nConstituents = 1;
+        fP.push_back(p);
+    }
+
+    size_t GetNParticles() const { return fP.size(); }
+
+    // Cluster the particles added since Clear(); jets with pT >= ptMin,
+    // ordered by decreasing pT
+    const std::vector<Jet> &Cluster() {
+        fJets.clear();
+        fHeap.clear();
+        std::fill(fTileHead.begin(), fTileHead.end(), -1);
+
+        for (size_t i = 0; i < fP.size(); i++) {
+            fP[i].active = true;
+            fP[i].version = 0;
+            SetKinematics(i);
+            InsertInTile(i);
+        }
+        for (size_t i = 0; i < fP.size(); i++) {
+            FindNeighbour(i);
+            Push(i);
+        }
+
+        while (!fHeap.empty()) {
+            std::pop_heap(fHeap.begin(), fHeap.end(), HeapOrder());
+            HeapEntry top = fHeap.back();
+            fHeap.pop_back();
+            int i = top.index;
+            if (!fP[i].active || fP[i].version != top.version) continue;   // stale entry
+
+            int j = fP[i].nn;
+            int oldTileI = fP[i].tile;
+            if (j < 0) {
+                // d_iB is smallest: i is a final jet
+                RemoveFromTile(i);
+                fP[i].active = false;
+                if (fP[i].px * fP[i].px + fP[i].py * fP[i].py >= fPtMin * fPtMin) {
+                    Jet jet = {fP[i].px, fP[i].py, fP[i].pz, fP[i].e, fP[i].nConstituents};
+                    fJets.push_back(jet);
+                }
+                UpdateAround(i, -1, oldTileI, oldTileI);
+                continue;
+            }
+
+            // E-scheme recombination of i and j into slot i
+            int oldTileJ = fP[j].tile;
+            RemoveFromTile(i);
+            RemoveFromTile(j);
+            fP[j].active = false;
+            fP[i].px += fP[j].px;
+            fP[i].py += fP[j].py;
+            fP[i].pz += fP[j].pz;
+            fP[i].e += fP[j].e;
+            fP[i].nConstituents += fP[j].nConstituents;
+            SetKinematics(i);
+            InsertInTile(i);
+            FindNeighbour(i);
+            Bump(i);
+            UpdateAround(i, j, oldTileI, oldTileJ);
+        }
+
+        std::sort(fJets.begin(), fJets.end(), [](const Jet &a, const Jet &b) {
+            return a.px * a.px + a.py * a.py > b.px * b.px + b.py * b.py;
+        });
+        return fJets;
+    }
+
+private:
+    struct PseudoJet {
+        double px, py, pz, e;
+        double rap, phi, kt2;   // kt2 = pT^(2p)
+        double nnDist;          // dR^2 to nn, R^2 if none within R
+        int nn;
+        int tile, prev, next;   // doubly linked list of the tile members
+        int version;            // invalidates older heap entries
+        int nConstituents;
+        bool active;
+    };
+
+    struct HeapEntry {
+        double dist;
+        int index;
+        int version;
+    };
+
+    struct HeapOrder {
+        bool operator()(const HeapEntry &a, const HeapEntry &b) const { return a.dist > b.dist; }
+    };
+
+    void SetKinematics(int i) {
+        PseudoJet &p = fP[i];
+        double pt2 = p.px * p.px + p.py * p.py;
+        p.phi = std::atan2(p.py, p.px);
+        if (p.phi < 0) p.phi += 2 * M_PI;
+        if (pt2 == 0 || p.e <= std::fabs(p.pz)) {
+            p.rap = p.pz >= 0 ? 1e5 : -1e5;
+        } else {
+            p.rap = 0.5 * std::log((p.e + p.pz) / (p.e - p.pz));
+        }
+        if (fAlg == kKt) p.kt2 = pt2;
+        else if (fAlg == kAntiKt) p.kt2 = pt2 > 0 ? 1. / pt2 : 1e300;
+        else p.kt2 = 1.;
+
+        int iy = (int)std::floor((p.rap + fMaxRap) / fRapWidth);
+        iy = std::min(std::max(iy, 0), fNRap - 1);
+        int iphi = std::min((int)(p.phi / fPhiWidth), fNPhi - 1);
+        p.tile = iy * fNPhi + iphi;
+    }
+
+    double DeltaR2(int i, int k) const {
+        double dy = fP[i].rap - fP[k].rap;
+        double dphi = std::fabs(fP[i].phi - fP[k].phi);
+        if (dphi > M_PI) dphi = 2 * M_PI - dphi;
+        return dy * dy + dphi * dphi;
+    }
+
+    void InsertInTile(int i) {
+        int t = fP[i].tile;
+        fP[i].prev = -1;
+        fP[i].next = fTileHead[t];
+        if (fTileHead[t] >= 0) fP[fTileHead[t]].prev = i;
+        fTileHead[t] = i;
+    }
+
+    void RemoveFromTile(int i) {
+        if (fP[i].prev >= 0) fP[fP[i].prev].next = fP[i].next;
+        else fTileHead[fP[i].tile] = fP[i].next;
+        if (fP[i].next >= 0) fP[fP[i].next].prev = fP[i].prev;
+    }
+
+    // Geometric nearest neighbour within R among the adjacent tiles
+    void FindNeighbour(int i) {
+        PseudoJet &p = fP[i];
+        p.nn = -1;
+        p.nnDist = fR2;
+        for (int n = fNeighbourStart[p.tile]; n < fNeighbourStart[p.tile + 1]; n++) {
+            for (int k = fTileHead[fNeighbours[n]]; k >= 0; k = fP[k].next) {
+                if (k == i) continue;
+                double d = DeltaR2(i, k);
+                if (d < p.nnDist) {
+                    p.nnDist = d;
+                    p.nn = k;
+                }
+            }
+        }
+    }
+
+    // d_ij to the nearest neighbour, or d_iB if there is none within R
+    double Distance(int i) const {
+        const PseudoJet &p = fP[i];
+        if (p.nn < 0) return p.kt2;
+        return std::min(p.kt2, fP[p.nn].kt2) * p.nnDist / fR2;
+    }
+
+    void Push(int i) {
+        HeapEntry h = {Distance(i), i, fP[i].version};
+        fHeap.push_back(h);
+        std::push_heap(fHeap.begin(), fHeap.end(), HeapOrder());
+    }
+
+    void Bump(int i) {
+        ++fP[i].version;
+        Push(i);
+    }
+
+    // Refresh the neighbours of everything near the tiles touched by a step:
+    // i is the merged jet (or the jet sent to the beam), j the absorbed one.
+    void UpdateAround(int i, int j, int tileA, int tileB) {
+        ++fStamp;
+        int tiles[3] = {tileA, tileB, fP[i].active ? fP[i].tile : tileA};
+        for (int a = 0; a < 3; a++) {
+            for (int n = fNeighbourStart[tiles[a]]; n < fNeighbourStart[tiles[a] + 1]; n++) {
+                int t = fNeighbours[n];
+                if (fTileStamp[t] == fStamp) continue;
+                fTileStamp[t] = fStamp;
+                for (int k = fTileHead[t]; k >= 0; k = fP[k].next) {
+                    if (k == i) continue;
+                    if (fP[k].nn == i || (j >= 0 && fP[k].nn == j)) {
+                        FindNeighbour(k);
+                        Bump(k);
+                    } else if (fP[i].active) {
+                        double d = DeltaR2(i, k);
+                        if (d < fP[k].nnDist) {
+                            fP[k].nnDist = d;
+                            fP[k].nn = i;
+                            Bump(k);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    Algorithm fAlg;
+    double fR2;
+    double fPtMin;
+    double fMaxRap;
+    int fNRap, fNPhi;
+    double fRapWidth, fPhiWidth;
+
+    std::vector<int> fNeighbours;       // flattened neighbour tiles
+    std::vector<int> fNeighbourStart;   // offsets into fNeighbours per tile
+    std::vector<int> fTileHead;         // first pseudojet in each tile, -1 if empty
+    std::vector<int> fTileStamp;        // de-duplicates tiles in UpdateAround
+    int fStamp;
+
+    std::vector<PseudoJet> fP;
+    std::vector<HeapEntry> fHeap;
+    std::vector<Jet> fJets;
+};
+
+#endif
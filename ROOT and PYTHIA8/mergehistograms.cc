@@ -0,0 +1,313 @@
+// Merge the histograms of many per-job ROOT files (pythia_histograms.root,
+// momentum_distributions_with_fits.root, ...) into one total.
+//
+//   mergehistograms [-j threads] [-a] total.root job1.root job2.root ...
+//   mergehistograms [-j threads] [-a] total.root @filelist.txt
+//
+//   -j N  number of worker threads (default: all cores)
+//   -a    add the inputs to an existing total.root instead of replacing it
+//
+// The histograms present in the first input define the layout. Each worker
+// owns one accumulator per histogram and walks its share of the files,
+// opening one file at a time and holding only that file's histograms until
+// they are added, so memory is bounded by threads x two sets of histograms
+// whatever the number of inputs. The per-worker partial sums are then
+// reduced pairwise as a tree.
+// Inputs that lack a layout histogram (e.g. output of a crashed job) or whose
+// binning differs from the layout are skipped and reported, and histograms
+// that are not in the layout are listed.
+// Non-histogram objects (e.g. the TF1 fits) are not merged, and neither are
+// histograms flagged TH1::kIsAverage (normalised spectra and ratios), since
+// their sum means nothing. The two-particle correlations of ppcollision.cc
+// are rebuilt from the merged pair sums instead; other flagged histograms
+// are listed as not merged.
+//
+// Build: g++ -O2 mergehistograms.cc -o mergehistograms $(root-config --cflags --libs)
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TROOT.h"
+#include "TSystem.h"
+#include "twoparticlecorrelation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Same dimension, number of bins and bin edges on every axis
+static bool SameBinning(const TH1 *a, const TH1 *b) {
+    if (a->GetDimension() != b->GetDimension()) return false;
+    const TAxis *axA[3] = {a->GetXaxis(), a->GetYaxis(), a->GetZaxis()};
+    const TAxis *axB[3] = {b->GetXaxis(), b->GetYaxis(), b->GetZaxis()};
+    for (int i = 0; i < a->GetDimension(); i++) {
+        if (axA[i]->GetNbins() != axB[i]->GetNbins()) return false;
+        for (int bin = 1; bin <= axA[i]->GetNbins() + 1; bin++) {
+            double ea = axA[i]->GetBinLowEdge(bin), eb = axB[i]->GetBinLowEdge(bin);
+            if (std::fabs(ea - eb) > 1e-9 * std::max(1., std::fabs(ea))) return false;
+        }
+    }
+    return true;
+}
+
+static bool IsHistogram(const TKey *key) {
+    TClass *cl = TClass::GetClass(key->GetClassName());
+    return cl && cl->InheritsFrom(TH1::Class());
+}
+
+static void AddUnique(std::vector<std::string> &list, const std::string &name) {
+    if (std::find(list.begin(), list.end(), name) == list.end()) list.push_back(name);
+}
+
+// Names of the histograms in a file, in key order (highest cycle only)
+static std::vector<std::string> ListHistograms(TFile *f) {
+    std::vector<std::string> names;
+    TIter next(f->GetListOfKeys());
+    while (TKey *key = (TKey*)next()) {
+        if (!IsHistogram(key)) {
+            std::cout << "Skipping non-histogram object " << key->GetName() << " (" << key->GetClassName() << ")" << std::endl;
+            continue;
+        }
+        AddUnique(names, key->GetName());
+    }
+    return names;
+}
+
+struct Partial {
+    std::vector<TH1*> hist;          // one accumulator per layout name, 0 until first seen
+    std::vector<std::string> bad;    // inputs rejected by this worker
+    std::vector<std::string> extra;  // histograms seen that are not in the layout
+    long nFiles = 0;
+};
+
+// Fold one file into a worker's accumulators. The file's histograms are read
+// one by one and only added once all of them are present, are histograms and
+// passed the binning check, so a bad input leaves the sums untouched. Names
+// with a null layout entry cannot be summed and are not read.
+static void MergeFile(const std::string &path, const std::vector<std::string> &names, const std::vector<TH1*> &layout,
+                      Partial &part) {
+    TFile *f = TFile::Open(path.c_str(), "READ");
+    if (!f || f->IsZombie()) {
+        part.bad.push_back(path + ": cannot open");
+        delete f;
+        return;
+    }
+
+    std::vector<TH1*> read(names.size(), (TH1*)0);
+    std::string error;
+    for (size_t i = 0; i < names.size() && error.empty(); i++) {
+        if (!layout[i]) continue;
+        TKey *key = f->GetKey(names[i].c_str());
+        if (!key) {
+            error = path + ": " + names[i] + " is missing";
+        } else if (!IsHistogram(key)) {
+            error = path + ": " + names[i] + " is a " + key->GetClassName() + ", not a histogram";
+        } else {
+            read[i] = (TH1*)key->ReadObj();
+            if (!read[i] || !SameBinning(read[i], layout[i])) error = path + ": binning of " + names[i] + " does not match";
+        }
+    }
+    TIter next(f->GetListOfKeys());
+    while (TKey *key = (TKey*)next()) {
+        if (IsHistogram(key) && std::find(names.begin(), names.end(), key->GetName()) == names.end())
+            AddUnique(part.extra, key->GetName());
+    }
+    f->Close();
+    delete f;
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!read[i]) continue;
+        if (!error.empty()) {
+            delete read[i];
+        } else if (!part.hist[i]) {
+            part.hist[i] = read[i];   // first one becomes the accumulator
+        } else {
+            part.hist[i]->Add(read[i]);
+            delete read[i];
+        }
+    }
+    if (error.empty()) ++part.nFiles;
+    else part.bad.push_back(error);
+}
+
+static TH1 *Find(const std::string &name, const std::vector<std::string> &names, const std::vector<TH1*> &hist) {
+    size_t i = std::find(names.begin(), names.end(), name) - names.begin();
+    return i < names.size() ? hist[i] : 0;
+}
+
+// <base>_same, <base>_mixed and <base> from TwoParticleCorrelation are
+// rebuilt from the summed <base>_same_pairs, <base>_mixed_pairs and
+// <base>_ntrig; returns 0 if name is not one of them or an input is missing
+static TH1 *RebuildCorrelation(const std::string &name, const std::vector<std::string> &names,
+                               const std::vector<TH1*> &hist) {
+    std::string base = name;
+    int kind = 0;   // 0 = S/B, 1 = same, 2 = mixed
+    if (base.size() > 5 && base.compare(base.size() - 5, 5, "_same") == 0) {
+        base.resize(base.size() - 5);
+        kind = 1;
+    } else if (base.size() > 6 && base.compare(base.size() - 6, 6, "_mixed") == 0) {
+        base.resize(base.size() - 6);
+        kind = 2;
+    }
+    TH2D *same = dynamic_cast<TH2D*>(Find(base + "_same_pairs", names, hist));
+    TH2D *mixed = dynamic_cast<TH2D*>(Find(base + "_mixed_pairs", names, hist));
+    TH1 *nTrig = Find(base + "_ntrig", names, hist);
+    if (!same || !mixed || !nTrig) return 0;
+    double n = nTrig->GetBinContent(1);
+    if (kind == 1) return TwoParticleCorrelation::MakeSame(same, n, name.c_str());
+    if (kind == 2) return TwoParticleCorrelation::MakeMixed(mixed, name.c_str());
+    return TwoParticleCorrelation::MakeCorrelation(same, mixed, n, name.c_str());
+}
+
+int main(int argc, char **argv) {
+    // --- Arguments ---
+    int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    bool append = false;
+    std::string output;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: -j needs a number of threads" << std::endl;
+                return 1;
+            }
+            nThreads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "-a") {
+            append = true;
+        } else if (output.empty()) {
+            output = arg;
+        } else if (arg[0] == '@') {
+            std::ifstream list(arg.substr(1).c_str());
+            if (!list.is_open()) {
+                std::cerr << "Error: cannot read file list " << arg.substr(1) << std::endl;
+                return 1;
+            }
+            std::string line;
+            while (list >> line) inputs.push_back(line);
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (output.empty() || inputs.empty()) {
+        std::cerr << "Usage: mergehistograms [-j threads] [-a] total.root input.root ... | @filelist.txt" << std::endl;
+        return 1;
+    }
+
+    // Incremental merge: the existing total is just one more input, and the
+    // new total is written next to it and renamed at the end
+    std::string target = output;
+    if (append && !gSystem->AccessPathName(output.c_str())) {
+        inputs.insert(inputs.begin(), output);
+        target = output + ".tmp";
+    }
+
+    ROOT::EnableThreadSafety();
+    TH1::AddDirectory(kFALSE);
+
+    // --- Layout from the first input; averaged histograms get a null entry ---
+    std::vector<std::string> names;
+    std::vector<TH1*> layout;
+    int nSummed = 0;
+    {
+        TFile *f = TFile::Open(inputs[0].c_str(), "READ");
+        if (!f || f->IsZombie()) {
+            std::cerr << "Error: cannot open " << inputs[0] << std::endl;
+            return 1;
+        }
+        names = ListHistograms(f);
+        for (size_t i = 0; i < names.size(); i++) {
+            TH1 *h = (TH1*)f->Get(names[i].c_str());
+            if (h->TestBit(TH1::kIsAverage)) {
+                delete h;
+                h = 0;
+            } else {
+                h->Reset();
+                ++nSummed;
+            }
+            layout.push_back(h);
+        }
+        f->Close();
+        delete f;
+    }
+    if (nSummed == 0) {
+        std::cerr << "Error: no histograms to sum in " << inputs[0] << std::endl;
+        return 1;
+    }
+
+    // --- Workers: each takes every nThreads-th file ---
+    nThreads = std::min<int>(nThreads, inputs.size());
+    std::vector<Partial> parts(nThreads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nThreads; t++) {
+        parts[t].hist.assign(names.size(), 0);
+        workers.push_back(std::thread([&, t]() {
+            for (size_t i = t; i < inputs.size(); i += nThreads) MergeFile(inputs[i], names, layout, parts[t]);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+    // --- Tree reduction of the partial sums ---
+    for (int stride = 1; stride < nThreads; stride *= 2) {
+        std::vector<std::thread> round;
+        for (int t = 0; t + stride < nThreads; t += 2 * stride) {
+            round.push_back(std::thread([&, t, stride]() {
+                Partial &dst = parts[t], &src = parts[t + stride];
+                for (size_t i = 0; i < names.size(); i++) {
+                    if (!src.hist[i]) continue;
+                    if (!dst.hist[i]) std::swap(dst.hist[i], src.hist[i]);
+                    else dst.hist[i]->Add(src.hist[i]);
+                }
+                dst.nFiles += src.nFiles;
+                dst.bad.insert(dst.bad.end(), src.bad.begin(), src.bad.end());
+                for (size_t i = 0; i < src.extra.size(); i++) AddUnique(dst.extra, src.extra[i]);
+            }));
+        }
+        for (size_t r = 0; r < round.size(); r++) round[r].join();
+    }
+    Partial &total = parts[0];
+
+    // --- Rebuild the averaged histograms that have additive inputs ---
+    std::vector<std::string> notMerged;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (layout[i]) continue;
+        TH1 *rebuilt = RebuildCorrelation(names[i], names, total.hist);
+        if (rebuilt) total.hist[i] = rebuilt;
+        else notMerged.push_back(names[i]);
+    }
+
+    // --- Write ---
+    TFile outFile(target.c_str(), "RECREATE");
+    if (outFile.IsZombie()) {
+        std::cerr << "Error: cannot write " << target << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        TH1 *h = total.hist[i] ? total.hist[i] : layout[i];
+        if (h) h->Write(names[i].c_str());
+    }
+    outFile.Close();
+    if (target != output && gSystem->Rename(target.c_str(), output.c_str()) != 0) {
+        std::cerr << "Error: cannot replace " << output << " with " << target << std::endl;
+        return 1;
+    }
+
+    std::cout << "Merged " << total.nFiles << " of " << inputs.size() << " files (" << nSummed
+              << " histograms, " << nThreads << " threads) into " << output << std::endl;
+    for (size_t i = 0; i < total.bad.size(); i++) std::cerr << "Skipped " << total.bad[i] << std::endl;
+    for (size_t i = 0; i < notMerged.size(); i++) {
+        std::cerr << "Not merged: " << notMerged[i] << " holds averaged or normalised values and cannot be summed"
+                  << std::endl;
+    }
+    for (size_t i = 0; i < total.extra.size(); i++) {
+        std::cerr << "Not merged: " << total.extra[i] << " is not in the layout of " << inputs[0] << std::endl;
+    }
+
+    return total.bad.empty() ? 0 : 2;
+}
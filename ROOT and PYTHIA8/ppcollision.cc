@@ -2,15 +2,50 @@
 #include "TFile.h"
 #include "TH1F.h"
 #include "TH2F.h"
+#include "TH1D.h"
+#include "TH2D.h"
 #include "TCanvas.h"
 #include "TLegend.h"
 #include "TStyle.h"
+#include "sparsehist.h"
+#include "jetclustering.h"
+#include "twoparticlecorrelation.h"
+#include "pairengine.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
 
 int main() {
     // --- Settings ---
     int nevents = 5000;   // Number of events
     double eCM = 200.0;     // RHIC energy (GeV) for STAR pp collisions
+    double jetR = 0.4;      // anti-kT radius
+    double jetPtMin = 3.0;  // GeV/c
+    // Pair candidates for pair_masses.root: 13 = muons, which also switches on
+    // charmonium production so the J/psi -> mu+ mu- peak that extract2.c fits
+    // is present; 0 = all charged particles, which only fills the 2-4 GeV/c^2
+    // window with combinatorial pairs (extract2.c then fits the background)
+    int pairPdg = 13;
+
+    // Generation mode:
+    //   0 = one unbiased run
+    //   1 = separate runs in the pTHat bins below
+    //   2 = one run with pTHat^4-biased sampling and per-event weights
+    // Mode 0 writes plain counts, so the output of many jobs can simply be
+    // summed with mergehistograms; sigmaGen / sum(w) is printed per run for
+    // normalising the merged result. Only the stitched modes 1 and 2 scale
+    // each run by sigmaGen / sum(w) and write cross sections in mb per bin;
+    // merged jobs of those modes must be divided by the number of jobs.
+    // In mode 1 nevents is split evenly between the runs and pythia.stat()
+    // is printed after each run. The first edge is replaced by the lower
+    // pTHat cut the unbiased run actually uses, so mode 1 covers the same
+    // phase space.
+    int genMode = 0;
+    std::vector<double> pTHatEdges = {0., 4., 7., 12., 20., -1.};   // GeV/c, -1 = no upper limit
+    double tailMin = 3.0, tailMax = 5.0;                            // pT tail reported per run, GeV/c
 
     // --- Initialize Pythia ---
     Pythia8::Pythia pythia;
@@ -19,50 +54,194 @@ int main() {
     pythia.readString("Beams:eCM = 200."); // STAR pp energy
     //pythia.readString("SoftQCD:inelastic = on");
     pythia.readString("HardQCD:all = on");
-    pythia.init();
+    if (pairPdg == 13) pythia.readString("Charmonium:all = on");
+    if (genMode == 2) {
+        pythia.readString("PhaseSpace:bias2Selection = on");
+        pythia.readString("PhaseSpace:bias2SelectionPow = 4.");
+    }
+    // HardQCD 2 -> 2 processes are cut at max(pTHatMin, pTHatMinDiverge)
+    pTHatEdges[0] = std::max(pythia.settings.parm("PhaseSpace:pTHatMin"),
+                             pythia.settings.parm("PhaseSpace:pTHatMinDiverge"));
 
     // --- ROOT histograms ---
-    TH1F *h_pT  = new TH1F("h_pT",  ";p_{T} [GeV/c];Entries", 100, 0, 5);
-    TH1F *h_eta = new TH1F("h_eta", ";#eta;Entries", 100, -5, 5);
-    TH1F *h_phi = new TH1F("h_phi", ";#phi [rad];Entries", 64, -M_PI, M_PI);
-    TH2F *h_pT_eta = new TH2F("h_pT_eta", ";#eta;p_{T} [GeV/c]", 50, -2.5, 2.5, 50, 0, 5);
+    std::string yUnit = genMode == 0 ? "Entries" : "#sigma [mb] / bin";
+    std::string yJets = genMode == 0 ? "Jets" : "#sigma_{jet} [mb] / bin";
+    TH1F *h_pT  = new TH1F("h_pT",  (";p_{T} [GeV/c];" + yUnit).c_str(), 100, 0, 5);
+    TH1F *h_eta = new TH1F("h_eta", (";#eta;" + yUnit).c_str(), 100, -5, 5);
+    TH1F *h_phi = new TH1F("h_phi", (";#phi [rad];" + yUnit).c_str(), 64, -M_PI, M_PI);
+    // pT vs eta is booked sparse: memory follows the occupied bins, so the
+    // binning can be made much finer without a dense Sumw2 array
+    SparseHist2 s_pT_eta("h_pT_eta", ";#eta;p_{T} [GeV/c]", 50, -2.5, 2.5, 50, 0, 5);
 
     h_pT->Sumw2();
     h_eta->Sumw2();
     h_phi->Sumw2();
-    h_pT_eta->Sumw2();
 
-    // --- Event loop ---
-    for (int i = 0; i < nevents; i++) {
-        if (!pythia.next()) continue;
+    // --- Jets: anti-kT on the final-state particles inside STAR acceptance ---
+    TH1F *h_jet_pT  = new TH1F("h_jet_pT",  (";p_{T}^{jet} [GeV/c];" + yJets).c_str(), 50, 0, 25);
+    TH1F *h_jet_eta = new TH1F("h_jet_eta", (";#eta^{jet};" + yJets).c_str(), 40, -1, 1);
+    TH1F *h_jet_phi = new TH1F("h_jet_phi", (";#phi^{jet} [rad];" + yJets).c_str(), 64, -M_PI, M_PI);
+    h_jet_pT->Sumw2();
+    h_jet_eta->Sumw2();
+    h_jet_phi->Sumw2();
+
+    JetClustering jetFinder(JetClustering::kAntiKt, jetR, jetPtMin, 1.0);
+
+    // --- Two-particle correlations: 20 eta x 32 phi cells, mixing with the last 10 events ---
+    TwoParticleCorrelation corr(20, -1.0, 1.0, 32, 10);
+
+    // --- Pair invariant mass, binned as in extract2.c, mixing with the last 10 events ---
+    PairEngine pairs(100, 2.0, 4.0, 10);
+    double tLoop = 0, tJets = 0;   // seconds
+
+    // --- Per-run accumulators are added into these with the run's weight ---
+    std::vector<TH1*> runHists = {h_pT, h_eta, h_phi, h_jet_pT, h_jet_eta, h_jet_phi};
+    std::vector<TH1*> sumHists;
+    for (size_t k = 0; k < runHists.size(); k++) {
+        sumHists.push_back((TH1*)runHists[k]->Clone(Form("%s_sum", runHists[k]->GetName())));
+    }
+    SparseHist2 s_pT_eta_sum("h_pT_eta", ";#eta;p_{T} [GeV/c]", 50, -2.5, 2.5, 50, 0, 5);
+    TwoParticleCorrelation corr_sum(20, -1.0, 1.0, 32, 0);
+    PairEngine pairs_sum(100, 2.0, 4.0, 0);
+
+    int nRuns = genMode == 1 ? pTHatEdges.size() - 1 : 1;
+    int nRunEvents = nevents / nRuns;
+
+    for (int run = 0; run < nRuns; run++) {
+        if (genMode == 1) {
+            pythia.readString("PhaseSpace:pTHatMin = " + std::to_string(pTHatEdges[run]));
+            pythia.readString("PhaseSpace:pTHatMax = " + std::to_string(pTHatEdges[run + 1]));
+        }
+        pythia.init();
+        corr.ClearPool();
+        pairs.ClearPool();
+
+        // --- Event loop ---
+        for (int i = 0; i < nRunEvents; i++) {
+            auto tStart = std::chrono::steady_clock::now();
+            if (!pythia.next()) continue;
+            double w = pythia.info.weight();   // 1 unless sampling is biased
+
+            jetFinder.Clear();
+            for (int j = 0; j < pythia.event.size(); j++) {
+                if (!pythia.event[j].isFinal()) continue; // Final state only
 
-        for (int j = 0; j < pythia.event.size(); j++) {
-            if (!pythia.event[j].isFinal()) continue; // Final state only
+                double pT  = pythia.event[j].pT();
+                double eta = pythia.event[j].eta();
+                double phi = pythia.event[j].phi();
 
-            double pT  = pythia.event[j].pT();
-            double eta = pythia.event[j].eta();
-            double phi = pythia.event[j].phi();
+                // STAR acceptance cut
+                if (fabs(eta) < 1.0 && pT > 0.2) {
+                    h_pT->Fill(pT, w);
+                    h_eta->Fill(eta, w);
+                    h_phi->Fill(phi, w);
+                    const Pythia8::Particle &p = pythia.event[j];
+                    if (p.isVisible()) jetFinder.AddParticle(p.px(), p.py(), p.pz(), p.e());   // no neutrinos in jets
+                    corr.AddParticle(eta, phi);
+                    if (pairPdg == 0 ? p.isCharged() : p.idAbs() == pairPdg)
+                        pairs.AddCandidate(p.px(), p.py(), p.pz(), p.e(), p.charge());
+                }
 
-            // STAR acceptance cut
-            if (fabs(eta) < 1.0 && pT > 0.2) {
-                h_pT->Fill(pT);
-                h_eta->Fill(eta);
-                h_phi->Fill(phi);
+                // Fill 2D histogram without acceptance cut to show full coverage
+                s_pT_eta.Fill(eta, pT, w);
             }
+            corr.EndEvent(w);
+            pairs.EndEvent(w);
 
-            // Fill 2D histogram without acceptance cut to show full coverage
-            h_pT_eta->Fill(eta, pT);
+            // Cluster jets and keep those fully inside |eta| < 1
+            auto tCluster = std::chrono::steady_clock::now();
+            const std::vector<JetClustering::Jet> &jets = jetFinder.Cluster();
+            for (size_t k = 0; k < jets.size(); k++) {
+                if (fabs(jets[k].eta()) > 1.0 - jetR) continue;
+                h_jet_pT->Fill(jets[k].pT(), w);
+                h_jet_eta->Fill(jets[k].eta(), w);
+                h_jet_phi->Fill(jets[k].phi(), w);
+            }
+            auto tEnd = std::chrono::steady_clock::now();
+            tJets += std::chrono::duration<double>(tEnd - tCluster).count();
+            tLoop += std::chrono::duration<double>(tEnd - tStart).count();
+        }
+
+        // --- Stitch this run: scale to its cross section and add to the sums ---
+        double sigmaPerW = pythia.info.sigmaGen() / pythia.info.weightSum();
+        double scale = genMode == 0 ? 1. : sigmaPerW;
+        double tailErr = 0;
+        double tail = h_pT->IntegralAndError(h_pT->FindBin(tailMin), h_pT->FindBin(tailMax) - 1, tailErr);
+        std::cout << "Run " << run;
+        if (genMode == 1) std::cout << " (pTHat " << pTHatEdges[run] << " - " << pTHatEdges[run + 1] << ")";
+        std::cout << ": " << pythia.info.nAccepted() << " events, sigmaGen = " << pythia.info.sigmaGen()
+                  << " +- " << pythia.info.sigmaErr() << " mb, sigmaGen / sum(w) = " << sigmaPerW << " mb, pT "
+                  << tailMin << "-" << tailMax << " GeV/c: "
+                  << tail * scale << " +- " << tailErr * scale
+                  << " (" << (tail > 0 ? 100. * tailErr / tail : 0.) << "%)" << std::endl;
+
+        for (size_t k = 0; k < runHists.size(); k++) {
+            sumHists[k]->Add(runHists[k], scale);
+            runHists[k]->Reset();
         }
+        s_pT_eta_sum.Add(s_pT_eta, scale);
+        s_pT_eta.Reset();
+        corr_sum.Add(corr, scale);
+        corr.Reset();
+        pairs_sum.Add(pairs, scale);
+        pairs.Reset();
+
+        // Cross sections and errors of this run (the next init() clears them)
+        pythia.stat();
     }
 
+    // The stitched totals go back into the original histograms for output
+    for (size_t k = 0; k < runHists.size(); k++) runHists[k]->Add(sumHists[k]);
+    double tailErr = 0;
+    double tail = h_pT->IntegralAndError(h_pT->FindBin(tailMin), h_pT->FindBin(tailMax) - 1, tailErr);
+    std::cout << "Total pT " << tailMin << "-" << tailMax << " GeV/c: " << tail << " +- " << tailErr
+              << " (" << (tail > 0 ? 100. * tailErr / tail : 0.) << "%)" << std::endl;
+
+    // Dense copy (with Sumw2 errors) for writing and plotting
+    TH2F *h_pT_eta = s_pT_eta_sum.ToTH2F();
+    std::cout << "h_pT_eta: " << s_pT_eta_sum.GetNbinsOccupied() << " of " << s_pT_eta_sum.GetNcells()
+              << " bins occupied, " << s_pT_eta_sum.MemoryBytes() / 1024 << " kB sparse storage" << std::endl;
+    std::cout << "Jet clustering: " << 100. * tJets / tLoop << "% of the event loop time" << std::endl;
+
+    // The pair sums and N_trig add up over jobs; the normalised histograms
+    // are rebuilt from them after merging (mergehistograms does this)
+    TH2D *h_dphi_deta_same_pairs  = corr_sum.MakeSamePairs("h_dphi_deta_same_pairs");
+    TH2D *h_dphi_deta_mixed_pairs = corr_sum.MakeMixedPairs("h_dphi_deta_mixed_pairs");
+    TH1D *h_dphi_deta_ntrig = new TH1D("h_dphi_deta_ntrig", ";;N_{trig}", 1, 0, 1);
+    h_dphi_deta_ntrig->SetBinContent(1, corr_sum.GetNTrig());
+    TH2D *h_dphi_deta_same  = corr_sum.MakeSame("h_dphi_deta_same");
+    TH2D *h_dphi_deta_mixed = corr_sum.MakeMixed("h_dphi_deta_mixed");
+    TH2D *h_dphi_deta       = corr_sum.MakeCorrelation("h_dphi_deta");
+
+    std::cout << "Pair engine: " << pairs_sum.GetNPairs() << " pairs, "
+              << pairs_sum.GetPairsPerSecond() << " pairs/s" << std::endl;
+
     // --- Save histograms to ROOT file ---
     TFile outFile("pythia_histograms.root", "RECREATE");
     h_pT->Write();
     h_eta->Write();
     h_phi->Write();
     h_pT_eta->Write();
+    h_jet_pT->Write();
+    h_jet_eta->Write();
+    h_jet_phi->Write();
+    h_dphi_deta_same_pairs->Write();
+    h_dphi_deta_mixed_pairs->Write();
+    h_dphi_deta_ntrig->Write();
+    h_dphi_deta_same->Write();
+    h_dphi_deta_mixed->Write();
+    h_dphi_deta->Write();
     outFile.Close();
 
+    // Pair spectra for extract2.c: extract2("pair_masses.root")
+    TFile pairFile("pair_masses.root", "RECREATE");
+    TH1D *hMass[3] = {pairs_sum.MakeOS("hMassOS"), pairs_sum.MakeLS("hMassLS"), pairs_sum.MakeMixed("hMassMixed")};
+    for (int k = 0; k < 3; k++) {
+        hMass[k]->GetYaxis()->SetTitle(genMode == 0 ? "Pairs / bin" : "#sigma_{pair} [mb] / bin");
+        hMass[k]->Write();
+    }
+    pairFile.Close();
+
     // --- STAR-style plotting ---
     gStyle->SetOptStat(0);
     gStyle->SetTitleFontSize(0.05);
@@ -97,8 +276,19 @@ int main() {
     c4->SaveAs("pT_vs_eta.pdf");
     c4->SaveAs("pT_vs_eta.png");
 
-    // --- Print Pythia statistics ---
-    pythia.stat();
+    // jet pT plot
+    TCanvas *c5 = new TCanvas("c5", "Jet pT Distribution", 800, 600);
+    c5->SetLogy();
+    h_jet_pT->SetMarkerStyle(20);
+    h_jet_pT->Draw("E1");
+    c5->SaveAs("jet_pT_distribution.pdf");
+    c5->SaveAs("jet_pT_distribution.png");
+
+    // dphi-deta correlation
+    TCanvas *c6 = new TCanvas("c6", "Two-Particle Correlation", 900, 700);
+    h_dphi_deta->Draw("SURF1");
+    c6->SaveAs("dphi_deta_correlation.pdf");
+    c6->SaveAs("dphi_deta_correlation.png");
 
     return 0;
 }
@@ -0,0 +1,457 @@
+#ifndef SPARSEHIST_H
+#define SPARSEHIST_H
+
+// Sparse histograms for fine-binned kinematic maps (e.g. eta, pT, phi).
+//
+// Only occupied bins are stored, in an open-addressing hash table keyed by the
+// ROOT global bin number (under/overflow included), so memory scales with the
+// number of filled bins instead of nx*ny*nz. Bins hold plain integer counts
+// while every fill has unit weight; the first weighted fill (or Scale/Add with
+// a factor != 1) promotes the whole table to (sumw, sumw2) storage. The
+// fill moments (sum w, w^2, w x, w x^2, ...) are kept as TH1 does, so the
+// dense copy has the exact mean and RMS rather than bin-centre values.
+//
+// Usage:
+//   SparseHist2 s("h_pT_eta", ";#eta;p_{T} [GeV/c]", 500, -2.5, 2.5, 500, 0, 5);
+//   s.Fill(eta, pT);
+//   TH2F *h = s.ToTH2F();   // dense copy with Sumw2 errors, for plotting/writing
+
+#include "TH1.h"
+#include "TH2F.h"
+#include "TH3F.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// --- Open-addressing hash table: Long64_t bin -> V ---
+template <class V>
+class SparseTable {
+public:
+    SparseTable() : fSize(0), fShift(64) {}
+
+    size_t Size() const { return fSize; }
+    size_t Capacity() const { return fKeys.size(); }
+    size_t MemoryBytes() const { return fKeys.capacity() * sizeof(Long64_t) + fVals.capacity() * sizeof(V); }
+
+    // Slot access for iteration: for (i < Capacity()) if (Used(i)) ...
+    bool Used(size_t i) const { return fKeys[i] >= 0; }
+    Long64_t Key(size_t i) const { return fKeys[i]; }
+    const V &Value(size_t i) const { return fVals[i]; }
+    V &Value(size_t i) { return fVals[i]; }
+
+    // Lookup without insertion; 0 if the bin is empty
+    const V *Find(Long64_t key) const {
+        if (fKeys.empty()) return 0;
+        size_t mask = fKeys.size() - 1;
+        for (size_t i = Slot(key); fKeys[i] >= 0; i = (i + 1) & mask) {
+            if (fKeys[i] == key) return &fVals[i];
+        }
+        return 0;
+    }
+
+    // Find-or-insert (value-initialized)
+    V &operator[](Long64_t key) {
+        if (!fKeys.empty()) {
+            size_t mask = fKeys.size() - 1;
+            size_t i = Slot(key);
+            for (; fKeys[i] >= 0; i = (i + 1) & mask) {
+                if (fKeys[i] == key) return fVals[i];
+            }
+            if (4 * (fSize + 1) <= 3 * fKeys.size()) return Insert(i, key);   // max load 0.75
+        }
+        Grow();
+        size_t mask = fKeys.size() - 1;
+        size_t i = Slot(key);
+        while (fKeys[i] >= 0) i = (i + 1) & mask;
+        return Insert(i, key);
+    }
+
+    void Clear() {
+        fKeys.clear();
+        fVals.clear();
+        fKeys.shrink_to_fit();
+        fVals.shrink_to_fit();
+        fSize = 0;
+        fShift = 64;
+    }
+
+private:
+    V &Insert(size_t i, Long64_t key) {
+        fKeys[i] = key;
+        fVals[i] = V();
+        ++fSize;
+        return fVals[i];
+    }
+
+    // Fibonacci hashing: neighbouring bins land in well separated slots
+    size_t Slot(Long64_t key) const {
+        return fShift >= 64 ? 0 : (size_t)(((ULong64_t)key * 0x9E3779B97F4A7C15ULL) >> fShift);
+    }
+
+    void Grow() {
+        std::vector<Long64_t> oldKeys;
+        std::vector<V> oldVals;
+        oldKeys.swap(fKeys);
+        oldVals.swap(fVals);
+
+        size_t cap = oldKeys.empty() ? 64 : 2 * oldKeys.size();
+        fShift = 64;
+        for (size_t c = cap; c > 1; c >>= 1) --fShift;
+        fKeys.assign(cap, -1);
+        fVals.assign(cap, V());
+        fSize = 0;
+
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            if (oldKeys[i] >= 0) (*this)[oldKeys[i]] = oldVals[i];
+        }
+    }
+
+    std::vector<Long64_t> fKeys;   // -1 = empty slot
+    std::vector<V> fVals;
+    size_t fSize;
+    int fShift;                    // 64 - log2(capacity)
+};
+
+// --- Dimension-independent storage, binning and conversion ---
+class SparseHistBase {
+public:
+    struct Cell {
+        double sumw;
+        double sumw2;
+        Cell() : sumw(0), sumw2(0) {}
+    };
+
+    struct Axis {
+        int n;
+        double min, max;
+    };
+
+    int GetDimension() const { return fDim; }
+    const char *GetName() const { return fName.c_str(); }
+    const char *GetTitle() const { return fTitle.c_str(); }
+    const Axis &GetAxis(int i) const { return fAxis[i]; }
+    double GetEntries() const { return fEntries; }
+    bool IsWeighted() const { return fWeighted; }
+
+    // Number of occupied bins and bytes actually held by the bin storage
+    size_t GetNbinsOccupied() const { return fWeighted ? fCells.Size() : fCounts.Size(); }
+    size_t MemoryBytes() const { return fCounts.MemoryBytes() + fCells.MemoryBytes(); }
+
+    // Total number of bins including under/overflow, as in TH1::GetNcells()
+    Long64_t GetNcells() const {
+        Long64_t n = 1;
+        for (int i = 0; i < fDim; i++) n *= fAxis[i].n + 2;
+        return n;
+    }
+
+    // Fill by global bin; this does not update the moments, use Fill() for that
+    void FillBin(Long64_t bin, double w = 1.) {
+        fEntries += 1;
+        if (!fWeighted && w == 1.) {
+            UInt_t &n = fCounts[bin];
+            if (n != UINT_MAX) {
+                ++n;
+                return;
+            }
+            Promote();
+        }
+        if (!fWeighted) Promote();
+        Cell &c = fCells[bin];
+        c.sumw += w;
+        c.sumw2 += w * w;
+    }
+
+    double GetBinContent(Long64_t bin) const {
+        if (fWeighted) {
+            const Cell *c = fCells.Find(bin);
+            return c ? c->sumw : 0.;
+        }
+        const UInt_t *n = fCounts.Find(bin);
+        return n ? *n : 0.;
+    }
+
+    double GetBinError(Long64_t bin) const {
+        if (fWeighted) {
+            const Cell *c = fCells.Find(bin);
+            return c ? std::sqrt(c->sumw2) : 0.;
+        }
+        const UInt_t *n = fCounts.Find(bin);
+        return n ? std::sqrt((double)*n) : 0.;
+    }
+
+    bool CheckConsistency(const SparseHistBase &o) const {
+        if (o.fDim != fDim) return false;
+        for (int i = 0; i < fDim; i++) {
+            if (o.fAxis[i].n != fAxis[i].n || o.fAxis[i].min != fAxis[i].min || o.fAxis[i].max != fAxis[i].max) return false;
+        }
+        return true;
+    }
+
+    // this += c * o (bins must match). Integer storage is kept when both
+    // sides are unweighted and c == 1, so merging plain counts stays cheap.
+    void Add(const SparseHistBase &o, double c = 1.) {
+        if (!CheckConsistency(o)) {
+            std::cerr << "SparseHist::Add: incompatible binning between " << fName << " and " << o.fName << std::endl;
+            return;
+        }
+        fEntries += o.fEntries;
+        for (int k = 0; k < kNStats; k++) fStats[k] += (k == 1 ? c * c : c) * o.fStats[k];
+        if (!fWeighted && !o.fWeighted && c == 1.) {
+            for (size_t i = 0; i < o.fCounts.Capacity(); i++) {
+                if (!o.fCounts.Used(i)) continue;
+                if (fWeighted) {
+                    AddWeighted(o, c, i);
+                    continue;
+                }
+                UInt_t add = o.fCounts.Value(i);
+                UInt_t &n = fCounts[o.fCounts.Key(i)];
+                if (n > UINT_MAX - add) {
+                    Promote();
+                    AddWeighted(o, c, i);
+                    continue;
+                }
+                n += add;
+            }
+            return;
+        }
+        if (!fWeighted) Promote();
+        if (o.fWeighted) {
+            for (size_t i = 0; i < o.fCells.Capacity(); i++) {
+                if (!o.fCells.Used(i)) continue;
+                Cell &dst = fCells[o.fCells.Key(i)];
+                dst.sumw += c * o.fCells.Value(i).sumw;
+                dst.sumw2 += c * c * o.fCells.Value(i).sumw2;
+            }
+        } else {
+            for (size_t i = 0; i < o.fCounts.Capacity(); i++) {
+                if (o.fCounts.Used(i)) AddWeighted(o, c, i);
+            }
+        }
+    }
+
+    void Scale(double c) {
+        if (c == 1.) return;
+        for (int k = 0; k < kNStats; k++) fStats[k] *= k == 1 ? c * c : c;
+        if (!fWeighted) Promote();
+        for (size_t i = 0; i < fCells.Capacity(); i++) {
+            if (!fCells.Used(i)) continue;
+            fCells.Value(i).sumw *= c;
+            fCells.Value(i).sumw2 *= c * c;
+        }
+    }
+
+    void Reset() {
+        fCounts.Clear();
+        fCells.Clear();
+        fWeighted = false;
+        fEntries = 0;
+        for (int k = 0; k < kNStats; k++) fStats[k] = 0;
+    }
+
+    // Copy occupied bins into a dense histogram with the same binning
+    void FillDense(TH1 *h) const {
+        if (h->GetNcells() != GetNcells()) {
+            std::cerr << "SparseHist::FillDense: " << h->GetName() << " does not match the binning of " << fName << std::endl;
+            return;
+        }
+        if (!h->GetSumw2N()) h->Sumw2();
+        if (fWeighted) {
+            for (size_t i = 0; i < fCells.Capacity(); i++) {
+                if (!fCells.Used(i)) continue;
+                h->SetBinContent(fCells.Key(i), fCells.Value(i).sumw);
+                h->SetBinError(fCells.Key(i), std::sqrt(fCells.Value(i).sumw2));
+            }
+        } else {
+            for (size_t i = 0; i < fCounts.Capacity(); i++) {
+                if (!fCounts.Used(i)) continue;
+                h->SetBinContent(fCounts.Key(i), fCounts.Value(i));
+                h->SetBinError(fCounts.Key(i), std::sqrt((double)fCounts.Value(i)));
+            }
+        }
+        double stats[kNStats];
+        std::copy(fStats, fStats + kNStats, stats);
+        h->PutStats(stats);
+        h->SetEntries(fEntries);
+    }
+
+    // Pick up the non-empty bins of a dense histogram with the same binning.
+    // Bins whose error differs from sqrt(content) switch to weighted storage.
+    void FillFromDense(const TH1 *h) {
+        if (h->GetNcells() != GetNcells()) {
+            std::cerr << "SparseHist::FillFromDense: " << h->GetName() << " does not match the binning of " << fName << std::endl;
+            return;
+        }
+        for (Long64_t bin = 0; bin < h->GetNcells(); bin++) {
+            double w = h->GetBinContent(bin);
+            if (w == 0) continue;
+            double e2 = h->GetBinError(bin) * h->GetBinError(bin);
+            double n = std::floor(w + 0.5);
+            if (!fWeighted && w == n && std::fabs(e2 - n) <= 1e-6 * n && n < UINT_MAX) {
+                UInt_t &count = fCounts[bin];
+                if (count <= UINT_MAX - (UInt_t)n) {
+                    count += (UInt_t)n;
+                    continue;
+                }
+                Promote();   // would wrap: this bin and the rest go weighted
+            }
+            if (!fWeighted) Promote();
+            Cell &c = fCells[bin];
+            c.sumw += w;
+            c.sumw2 += e2;
+        }
+        fEntries += h->GetEntries();
+        double stats[kNStats] = {0};
+        h->GetStats(stats);
+        for (int k = 0; k < kNStats; k++) fStats[k] += stats[k];
+    }
+
+protected:
+    SparseHistBase(const char *name, const char *title, int dim)
+        : fName(name), fTitle(title), fDim(dim), fWeighted(false), fEntries(0) {
+        for (int k = 0; k < kNStats; k++) fStats[k] = 0;
+    }
+
+    // TH1::GetStats layout: sumw, sumw2, then sumwx, sumwx2, sumwy, sumwy2,
+    // sumwxy (2D) and sumwz, sumwz2, sumwxz, sumwyz (3D)
+    enum { kNStats = 11 };
+
+    // Fills outside the axis ranges do not enter the moments, as in TH1::Fill
+    bool InRange(int i, double x) const { return x >= fAxis[i].min && x < fAxis[i].max; }
+
+    void AddMoments(double w, double x, double y, double z) {
+        fStats[0] += w;
+        fStats[1] += w * w;
+        fStats[2] += w * x;
+        fStats[3] += w * x * x;
+        fStats[4] += w * y;
+        fStats[5] += w * y * y;
+        fStats[6] += w * x * y;
+        if (fDim < 3) return;
+        fStats[7] += w * z;
+        fStats[8] += w * z * z;
+        fStats[9] += w * x * z;
+        fStats[10] += w * y * z;
+    }
+
+    // ROOT bin convention: 0 = underflow, n + 1 = overflow
+    int AxisBin(int i, double x) const {
+        const Axis &a = fAxis[i];
+        if (x < a.min) return 0;
+        if (!(x < a.max)) return a.n + 1;
+        int b = 1 + (int)(a.n * (x - a.min) / (a.max - a.min));
+        return b > a.n ? a.n : b;
+    }
+
+    void SetAxis(int i, int n, double min, double max) {
+        fAxis[i].n = n;
+        fAxis[i].min = min;
+        fAxis[i].max = max;
+    }
+
+    std::string fName;
+    std::string fTitle;
+    int fDim;
+    Axis fAxis[3];
+    double fStats[kNStats];
+
+private:
+    void AddWeighted(const SparseHistBase &o, double c, size_t i) {
+        Cell &dst = fCells[o.fCounts.Key(i)];
+        dst.sumw += c * o.fCounts.Value(i);
+        dst.sumw2 += c * c * o.fCounts.Value(i);
+    }
+
+    // Move integer counts into (sumw, sumw2) cells; n unit-weight fills -> (n, n)
+    void Promote() {
+        for (size_t i = 0; i < fCounts.Capacity(); i++) {
+            if (!fCounts.Used(i)) continue;
+            Cell &c = fCells[fCounts.Key(i)];
+            c.sumw += fCounts.Value(i);
+            c.sumw2 += fCounts.Value(i);
+        }
+        fCounts.Clear();
+        fWeighted = true;
+    }
+
+    SparseTable<UInt_t> fCounts;   // unweighted storage
+    SparseTable<Cell> fCells;      // weighted storage, used once promoted
+    bool fWeighted;
+    double fEntries;
+};
+
+// --- 2D: drop-in for a TH2F booked with Sumw2() ---
+class SparseHist2 : public SparseHistBase {
+public:
+    SparseHist2(const char *name, const char *title, int nx, double xmin, double xmax, int ny, double ymin, double ymax)
+        : SparseHistBase(name, title, 2) {
+        SetAxis(0, nx, xmin, xmax);
+        SetAxis(1, ny, ymin, ymax);
+    }
+
+    Long64_t FindBin(double x, double y) const {
+        return AxisBin(0, x) + (Long64_t)(fAxis[0].n + 2) * AxisBin(1, y);
+    }
+
+    void Fill(double x, double y, double w = 1.) {
+        FillBin(FindBin(x, y), w);
+        if (InRange(0, x) && InRange(1, y)) AddMoments(w, x, y, 0.);
+    }
+
+    TH2F *ToTH2F(const char *name = 0) const {
+        TH2F *h = new TH2F(name ? name : GetName(), GetTitle(),
+                           fAxis[0].n, fAxis[0].min, fAxis[0].max, fAxis[1].n, fAxis[1].min, fAxis[1].max);
+        FillDense(h);
+        return h;
+    }
+
+    static SparseHist2 FromTH2(const TH2 *h) {
+        SparseHist2 s(h->GetName(), h->GetTitle(),
+                      h->GetNbinsX(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax(),
+                      h->GetNbinsY(), h->GetYaxis()->GetXmin(), h->GetYaxis()->GetXmax());
+        s.FillFromDense(h);
+        return s;
+    }
+};
+
+// --- 3D: e.g. (eta, pT, phi) acceptance maps ---
+class SparseHist3 : public SparseHistBase {
+public:
+    SparseHist3(const char *name, const char *title, int nx, double xmin, double xmax, int ny, double ymin, double ymax,
+                int nz, double zmin, double zmax)
+        : SparseHistBase(name, title, 3) {
+        SetAxis(0, nx, xmin, xmax);
+        SetAxis(1, ny, ymin, ymax);
+        SetAxis(2, nz, zmin, zmax);
+    }
+
+    Long64_t FindBin(double x, double y, double z) const {
+        return AxisBin(0, x) + (Long64_t)(fAxis[0].n + 2) * (AxisBin(1, y) + (Long64_t)(fAxis[1].n + 2) * AxisBin(2, z));
+    }
+
+    void Fill(double x, double y, double z, double w = 1.) {
+        FillBin(FindBin(x, y, z), w);
+        if (InRange(0, x) && InRange(1, y) && InRange(2, z)) AddMoments(w, x, y, z);
+    }
+
+    TH3F *ToTH3F(const char *name = 0) const {
+        TH3F *h = new TH3F(name ? name : GetName(), GetTitle(),
+                           fAxis[0].n, fAxis[0].min, fAxis[0].max, fAxis[1].n, fAxis[1].min, fAxis[1].max,
+                           fAxis[2].n, fAxis[2].min, fAxis[2].max);
+        FillDense(h);
+        return h;
+    }
+
+    static SparseHist3 FromTH3(const TH3 *h) {
+        SparseHist3 s(h->GetName(), h->GetTitle(),
+                      h->GetNbinsX(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax(),
+                      h->GetNbinsY(), h->GetYaxis()->GetXmin(), h->GetYaxis()->GetXmax(),
+                      h->GetNbinsZ(), h->GetZaxis()->GetXmin(), h->GetZaxis()->GetXmax());
+        s.FillFromDense(h);
+        return s;
+    }
+};
+
+#endif
@@ -0,0 +1,361 @@
+#ifndef TWOPARTICLECORRELATION_H
+#define TWOPARTICLECORRELATION_H
+
+// Two-particle (dphi, deta) correlations from binned occupancy grids.
+//
+// Each event's particles are counted in an (eta, phi) grid n(x). The pair
+// distribution is the auto-correlation of that grid,
+//     S(d) = sum_x n(x) n(x - d) = IFFT(|FFT(n)|^2),
+// so instead of looping over N^2 pairs every event costs one 2D FFT of the
+// grid. phi is periodic as it stands; eta is zero padded to at least
+// 2*nEta - 1 rows so no deta wraps around. Since the inverse transform is
+// linear, |FFT(n)|^2 is summed over events and inverted only once in the
+// Make*() calls.
+//
+// The mixed-event distribution uses the cross-correlation FFT(a) conj(FFT(b))
+// between the current event and the previous poolDepth events. Transformed
+// grids live in a fixed ring buffer and each event is transformed directly
+// into the slot it will occupy in the pool, so nothing is copied.
+//
+// Pairs are binned at grid resolution: two particles in the same cell count
+// as deta = dphi = 0.
+//
+// Only the pair sums (MakeSamePairs, MakeMixedPairs) and N_trig are additive.
+// To combine several jobs, sum those and rebuild the normalised histograms
+// with the static Make*() overloads.
+
+#include "TH2D.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class TwoParticleCorrelation {
+public:
+    // nPhi must be a power of two
+    TwoParticleCorrelation(int nEta, double etaMin, double etaMax, int nPhi, int poolDepth = 10)
+        : fNEta(nEta), fNPhi(nPhi), fEtaMin(etaMin), fEtaMax(etaMax), fPoolDepth(poolDepth) {
+        // The radix-2 FFT is only valid for power-of-two lengths
+        if (nPhi < 1 || (nPhi & (nPhi - 1))) {
+            throw std::invalid_argument("TwoParticleCorrelation: nPhi = " + std::to_string(nPhi) + " is not a power of two");
+        }
+        fNPad = 1;
+        while (fNPad < 2 * nEta - 1) fNPad <<= 1;
+        fSize = fNPad * fNPhi;
+
+        fSlots.assign((size_t)(fPoolDepth + 1) * fSize, Complex(0, 0));
+        fSlotN.assign(fPoolDepth + 1, 0);
+        fSlotW.assign(fPoolDepth + 1, 0);
+        fCurrent = 0;
+        fColumn.resize(fNPad);
+        MakeTwiddles(fNPhi, fTwPhi);
+        MakeTwiddles(fNPad, fTwEta);
+
+        Reset();
+    }
+
+    void Reset() {
+        fSame.assign(fSize, 0.);
+        fSameW2.assign(fSize, 0.);
+        fMixed.assign(fSize, Complex(0, 0));
+        fMixedW2.assign(fSize, Complex(0, 0));
+        fNTrig = 0;
+        fSelf = 0;
+        fSelfW2 = 0;
+        fNEvents = 0;
+        fNMixed = 0;
+    }
+
+    // Add c times the same- and mixed-event FFT sums and trigger counts of o,
+    // which must share the (eta, phi) grid. The transformed grids of o's pool
+    // are not copied.
+    void Add(const TwoParticleCorrelation &o, double c = 1.) {
+        if (o.fSize != fSize || o.fNEta != fNEta || o.fEtaMin != fEtaMin || o.fEtaMax != fEtaMax) {
+            std::cerr << "TwoParticleCorrelation::Add: incompatible binning" << std::endl;
+            return;
+        }
+        for (int k = 0; k < fSize; k++) {
+            fSame[k] += c * o.fSame[k];
+            fSameW2[k] += c * c * o.fSameW2[k];
+            fMixed[k] += c * o.fMixed[k];
+            fMixedW2[k] += c * c * o.fMixedW2[k];
+        }
+        fNTrig += c * o.fNTrig;
+        fSelf += c * o.fSelf;
+        fSelfW2 += c * c * o.fSelfW2;
+        fNEvents += o.fNEvents;
+        fNMixed += o.fNMixed;
+    }
+
+    // Count one particle of the current event; phi in radians, any range
+    void AddParticle(double eta, double phi) {
+        if (eta < fEtaMin || !(eta < fEtaMax)) return;
+        int ie = (int)(fNEta * (eta - fEtaMin) / (fEtaMax - fEtaMin));
+        if (ie >= fNEta) ie = fNEta - 1;
+        phi = std::fmod(phi, 2 * M_PI);
+        if (phi < 0) phi += 2 * M_PI;
+        int ip = (int)(fNPhi * phi / (2 * M_PI));
+        if (ip >= fNPhi) ip = fNPhi - 1;
+
+        Complex *grid = Slot(fCurrent);
+        grid[ie * fNPhi + ip] += 1.;
+        ++fSlotN[fCurrent];
+    }
+
+    // Close the current event: accumulate same-event pairs with weight w and
+    // mixed-event pairs with w times the pooled event's weight, then move the
+    // event into the pool.
+    void EndEvent(double w = 1.) {
+        Complex *cur = Slot(fCurrent);
+        double n = fSlotN[fCurrent];
+        if (n == 0) return;
+
+        Transform2D(cur, false);
+
+        for (int k = 0; k < fSize; k++) {
+            double p = std::norm(cur[k]);
+            fSame[k] += w * p;
+            fSameW2[k] += w * w * p;
+        }
+        fNTrig += w * n;
+        fSelf += w * n;
+        fSelfW2 += w * w * n;
+        ++fNEvents;
+
+        for (int s = 0; s <= fPoolDepth; s++) {
+            if (s == fCurrent || fSlotN[s] == 0) continue;
+            const Complex *old = Slot(s);
+            double wm = w * fSlotW[s];
+            for (int k = 0; k < fSize; k++) {
+                Complex p = cur[k] * std::conj(old[k]);
+                fMixed[k] += wm * p;
+                fMixedW2[k] += wm * wm * p;
+            }
+            ++fNMixed;
+        }
+        fSlotW[fCurrent] = w;
+
+        // The slot after the current one becomes the next event's grid, which
+        // drops the oldest event from the pool once it is full
+        fCurrent = (fCurrent + 1) % (fPoolDepth + 1);
+        Complex *next = Slot(fCurrent);
+        for (int k = 0; k < fSize; k++) next[k] = 0.;
+        fSlotN[fCurrent] = 0;
+    }
+
+    // Mark every pooled grid as empty so that later events are only mixed
+    // with each other; particles already added to the current event stay.
+    void ClearPool() {
+        for (int s = 0; s <= fPoolDepth; s++) {
+            if (s == fCurrent) continue;
+            fSlotN[s] = 0;
+        }
+    }
+
+    double GetNTrig() const { return fNTrig; }
+    Long64_t GetNEvents() const { return fNEvents; }
+    Long64_t GetNMixed() const { return fNMixed; }
+
+    // Same-event pair sums, sum of w dN_pair, self pairs removed
+    TH2D *MakeSamePairs(const char *name) {
+        std::vector<Complex> buf(fSame.begin(), fSame.end());
+        std::vector<Complex> buf2(fSameW2.begin(), fSameW2.end());
+        Transform2D(&buf[0], true);
+        Transform2D(&buf2[0], true);
+        buf[0] -= fSelf;
+        buf2[0] -= fSelfW2;
+        TH2D *h = Book(name, ";#Delta#phi [rad];#Delta#eta;dN_{pair}");
+        Unfold(buf, buf2, h, 1.);
+        return h;
+    }
+
+    // Mixed-event pair sums, sum of w w_pool dN_pair
+    TH2D *MakeMixedPairs(const char *name) {
+        std::vector<Complex> buf(fMixed);
+        std::vector<Complex> buf2(fMixedW2);
+        Transform2D(&buf[0], true);
+        Transform2D(&buf2[0], true);
+        TH2D *h = Book(name, ";#Delta#phi [rad];#Delta#eta;dN_{pair}^{mixed}");
+        Unfold(buf, buf2, h, 1.);
+        return h;
+    }
+
+    // Normalised histograms from this object's own sums, as the static
+    // versions below
+    TH2D *MakeSame(const char *name) {
+        TH2D *same = MakeSamePairs((std::string(name) + "_pairs_tmp").c_str());
+        TH2D *h = MakeSame(same, fNTrig, name);
+        delete same;
+        return h;
+    }
+
+    TH2D *MakeMixed(const char *name) {
+        TH2D *mixed = MakeMixedPairs((std::string(name) + "_pairs_tmp").c_str());
+        TH2D *h = MakeMixed(mixed, name);
+        delete mixed;
+        return h;
+    }
+
+    TH2D *MakeCorrelation(const char *name) {
+        TH2D *same = MakeSamePairs((std::string(name) + "_same_pairs_tmp").c_str());
+        TH2D *mixed = MakeMixedPairs((std::string(name) + "_mixed_pairs_tmp").c_str());
+        TH2D *h = MakeCorrelation(same, mixed, fNTrig, name);
+        delete same;
+        delete mixed;
+        return h;
+    }
+
+    // The histograms below are normalised or ratios and cannot be summed, so
+    // they carry TH1::kIsAverage.
+
+    // Same-event pair counts per trigger particle
+    static TH2D *MakeSame(const TH2D *samePairs, double nTrig, const char *name) {
+        TH2D *h = (TH2D*)samePairs->Clone(name);
+        h->SetTitle(";#Delta#phi [rad];#Delta#eta;1/N_{trig} dN_{pair}");
+        h->Scale(nTrig > 0 ? 1. / nTrig : 0.);
+        h->SetBit(TH1::kIsAverage);
+        return h;
+    }
+
+    // Mixed-event pair counts normalised to 1 on average at deta = 0
+    static TH2D *MakeMixed(const TH2D *mixedPairs, const char *name) {
+        TH2D *h = (TH2D*)mixedPairs->Clone(name);
+        h->SetTitle(";#Delta#phi [rad];#Delta#eta;B(#Delta#eta,#Delta#phi)/B(0,#Delta#phi)");
+        int by0 = (h->GetNbinsY() + 1) / 2;   // deta = 0
+        double norm = 0;
+        for (int bx = 1; bx <= h->GetNbinsX(); bx++) norm += h->GetBinContent(bx, by0);
+        norm /= h->GetNbinsX();
+        h->Scale(norm > 0 ? 1. / norm : 0.);
+        h->SetBit(TH1::kIsAverage);
+        return h;
+    }
+
+    // 1/N_trig d^2N/(d deta d dphi) = S / B, with B normalised as in MakeMixed
+    static TH2D *MakeCorrelation(const TH2D *samePairs, const TH2D *mixedPairs, double nTrig, const char *name) {
+        TH2D *same = MakeSame(samePairs, nTrig, (std::string(name) + "_same_tmp").c_str());
+        TH2D *mixed = MakeMixed(mixedPairs, (std::string(name) + "_mixed_tmp").c_str());
+        TH2D *h = (TH2D*)samePairs->Clone(name);
+        h->Reset();
+        h->SetTitle(";#Delta#phi [rad];#Delta#eta;1/N_{trig} d^{2}N/d#Delta#etad#Delta#phi");
+        double area = h->GetXaxis()->GetBinWidth(1) * h->GetYaxis()->GetBinWidth(1);
+        for (int bx = 1; bx <= h->GetNbinsX(); bx++) {
+            for (int by = 1; by <= h->GetNbinsY(); by++) {
+                double b = mixed->GetBinContent(bx, by);
+                if (b <= 0) continue;
+                h->SetBinContent(bx, by, same->GetBinContent(bx, by) / b / area);
+                h->SetBinError(bx, by, same->GetBinError(bx, by) / b / area);
+            }
+        }
+        h->ResetStats();
+        h->SetBit(TH1::kIsAverage);
+        delete same;
+        delete mixed;
+        return h;
+    }
+
+private:
+    typedef std::complex<double> Complex;
+
+    Complex *Slot(int s) { return &fSlots[(size_t)s * fSize]; }
+
+    static void MakeTwiddles(int n, std::vector<Complex> &tw) {
+        tw.resize(n / 2 > 0 ? n / 2 : 1);
+        for (int k = 0; k < n / 2; k++) tw[k] = std::polar(1., -2 * M_PI * k / n);
+    }
+
+    // In-place iterative radix-2 FFT of n contiguous points
+    static void FFT(Complex *a, int n, const std::vector<Complex> &tw, bool inverse) {
+        for (int i = 1, j = 0; i < n; i++) {
+            int bit = n >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) std::swap(a[i], a[j]);
+        }
+        for (int len = 2; len <= n; len <<= 1) {
+            int step = n / len;
+            for (int i = 0; i < n; i += len) {
+                for (int k = 0; k < len / 2; k++) {
+                    Complex t = tw[k * step];
+                    if (inverse) t = std::conj(t);
+                    Complex u = a[i + k];
+                    Complex v = a[i + k + len / 2] * t;
+                    a[i + k] = u + v;
+                    a[i + k + len / 2] = u - v;
+                }
+            }
+        }
+    }
+
+    // Rows along phi, then columns along (padded) eta. Forward transforms
+    // skip the zero padding rows, which only ever hold zeros.
+    void Transform2D(Complex *grid, bool inverse) {
+        int rows = inverse ? fNPad : fNEta;
+        for (int ie = 0; ie < rows; ie++) FFT(grid + ie * fNPhi, fNPhi, fTwPhi, inverse);
+        for (int ip = 0; ip < fNPhi; ip++) {
+            for (int ie = 0; ie < fNPad; ie++) fColumn[ie] = grid[ie * fNPhi + ip];
+            FFT(&fColumn[0], fNPad, fTwEta, inverse);
+            for (int ie = 0; ie < fNPad; ie++) grid[ie * fNPhi + ip] = fColumn[ie];
+        }
+        if (inverse) {
+            for (int k = 0; k < fSize; k++) grid[k] /= fSize;
+        }
+    }
+
+    // dphi from -pi/2 to 3pi/2, deta over +-(nEta - 1) cells, centred on
+    // the grid shifts
+    TH2D *Book(const char *name, const char *title) const {
+        double wPhi = 2 * M_PI / fNPhi;
+        double wEta = (fEtaMax - fEtaMin) / fNEta;
+        TH2D *h = new TH2D(name, title, fNPhi, -0.5 * M_PI - 0.5 * wPhi, 1.5 * M_PI - 0.5 * wPhi,
+                           2 * fNEta - 1, -(fNEta - 0.5) * wEta, (fNEta - 0.5) * wEta);
+        h->Sumw2();
+        return h;
+    }
+
+    // Copy the shift-indexed grid into h. Errors treat the pair count of each
+    // event (or event pair) as Poisson, i.e. var = sum of w^2 S_event (buf2).
+    void Unfold(const std::vector<Complex> &buf, const std::vector<Complex> &buf2, TH2D *h, double scale) const {
+        double wPhi = 2 * M_PI / fNPhi;
+        double cMax = 0;
+        for (int k = 0; k < fSize; k++) cMax = std::max(cMax, std::fabs(buf[k].real()));
+        for (int de = -(fNEta - 1); de <= fNEta - 1; de++) {
+            int row = (de + fNPad) % fNPad;
+            for (int ip = 0; ip < fNPhi; ip++) {
+                double c = buf[row * fNPhi + ip].real();
+                double v = buf2[row * fNPhi + ip].real();
+                if (std::fabs(c) < 1e-12 * cMax) c = 0;   // FFT round-off
+                double dphi = ip * wPhi;
+                if (dphi >= 1.5 * M_PI - 0.5 * wPhi) dphi -= 2 * M_PI;
+                int bx = h->GetXaxis()->FindBin(dphi);
+                int by = de + fNEta;
+                h->SetBinContent(bx, by, c * scale);
+                h->SetBinError(bx, by, v > 0 ? std::sqrt(v) * scale : 0.);
+            }
+        }
+        h->ResetStats();
+    }
+
+    int fNEta, fNPhi, fNPad, fSize;
+    double fEtaMin, fEtaMax;
+    int fPoolDepth;
+
+    std::vector<Complex> fSlots;   // poolDepth + 1 transformed grids (ring buffer)
+    std::vector<double> fSlotN;    // particles per slot, 0 = empty
+    std::vector<double> fSlotW;    // event weight per slot
+    int fCurrent;                  // slot being filled by the current event
+
+    std::vector<double> fSame;     // sum of w |FFT(n)|^2
+    std::vector<double> fSameW2;   // sum of w^2 |FFT(n)|^2, for errors
+    std::vector<Complex> fMixed;   // sum of w w_pool FFT(n) conj(FFT(n_pool))
+    std::vector<Complex> fMixedW2; // same with (w w_pool)^2, for errors
+    double fNTrig, fSelf, fSelfW2;
+    Long64_t fNEvents, fNMixed;
+
+    std::vector<Complex> fColumn;
+    std::vector<Complex> fTwPhi, fTwEta;
+};
+
+#endif